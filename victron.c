@@ -27,7 +27,12 @@ Next is the NMEA String that is used. Depending on the string the data is displa
 IIXDR is the default. Others an be used to show data on devices that cannot display IIXDR (which is probably the norm). 
 The last letter defines the Unit that is used in the NMEA String. This way a battery Voltage can for example 
 be sent as a DPT Value with the unit m and displayed on a display that will only display depth values. It is also possible
-to use identical NMEA String for two different values, they will then be displayed  */
+to use identical NMEA String for two different values, they will then be displayed
+
+If the serial device hangs up (cable unplugged, adapter reset) it is closed and reopened with a backoff of up to
+MAXBACKOFF seconds, or at once when it shows up again in /dev. For a VE.Direct USB cable use the stable
+/dev/serial/by-id/... path as filename, the ttyUSB number may change when the adapter is plugged in again.
+The device need not be present at start. While it is missing, the 88.8 values are still sent every 10 seconds.  */
 
 #include <sys/stat.h>
 #include <sys/types.h>
@@ -49,9 +54,16 @@ to use identical NMEA String for two different values, they will then be display
 #include <grp.h>
 #include <pwd.h>
 #include <termios.h>
+#include <poll.h>
+#include <errno.h>
+#include <libgen.h>
+#ifdef __linux__
+#include <sys/inotify.h>
+#endif
 
 #define DEFSERIALQSIZE 128
 #define BUFSIZE 1024
+#define MAXBACKOFF 10      // Max. seconds between two reopen attempts of a lost serial device
 
 
 
@@ -72,6 +84,13 @@ struct victron_nmea nmeastringe;
 struct victron_nmea nmeastringy;
 struct victron_nmea nmeastringo;
 
+char *serialname;         // Serial device as given on the command line, e.g. /dev/serial/by-id/usb-VictronEnergy...
+int dev = -1;             // fd of serial device, -1 while device is gone
+int devlost = 0;          // Set when hangup or I/O error is detected on dev, device is reopened then
+int inotifyfd = -1;       // Watches /dev and the directory of serialname for a reappearing device
+int backoff = 1;          // Seconds to wait before next reopen attempt
+int devevent = 0;         // Set when wait_victron was woken by inotify rather than by the backoff timer
+
 
 
 //returns delta of char in string
@@ -123,7 +142,20 @@ int read_victron(int fd, char *buf)
     i= 0;
     do {
         usleep(40000);
+        struct pollfd pfd;
+        pfd.fd = fd;
+        pfd.events = POLLIN;
+        if ((poll(&pfd, 1, 0) > 0) && (pfd.revents & (POLLHUP|POLLERR|POLLNVAL))) {
+		printf("Serial device hangup\n");
+		devlost = 1;    // cable unplugged or adapter reset, reopen in main loop
+		nodata = 1;
+		break;
+	}
         signed char chars_read = read(fd,&bufint[amount],50) ;   // Get approx. 2-3  blocks of data from input
+        if ((chars_read < 0) && ((errno == EIO) || (errno == ENXIO) || (errno == ENODEV))) {
+		printf("Serial device error %s\n", strerror(errno));
+		devlost = 1;
+	}
         if (chars_read <= 0) {
 		nodata = 1;     // no data received, revert to failure data 
 		break;
@@ -488,6 +520,161 @@ int read_victron(int fd, char *buf)
 }
 
 
+/*
+ * Open serial interface to Victron Controller and set termios (19200 baud, raw, 0.2 sec gap timeout)
+ * Args: name of device
+ * Returns: fd of device, -1 on error
+ */
+int open_serial(char *name)
+{
+  struct termios attribs;
+  int fd;
+
+  fd = open(name, (O_RDWR|O_NOCTTY));
+  if (fd < 0) {
+    printf("Failed to open %s: %s\n", name, strerror(errno));
+    return(-1);
+  }
+  /*
+   * Get the current settings. This saves us from having to initialize a struct termios from scratch.
+   */
+  if (tcgetattr(fd, &attribs) < 0) {
+    printf("tcgetattr failed on %s\n", name);
+    close(fd);
+    return(-1);
+  }
+  if (cfsetospeed(&attribs, B19200) < 0) {
+    printf("invalid baud rate");
+    close(fd);
+    return(-1);
+  }
+  attribs.c_lflag &= ~(ICANON|ECHO); /* Clear ICANON and ECHO. */
+  attribs.c_iflag &= ~(INLCR|ICRNL); /* Clear ICANON and ECHO. */
+  attribs.c_cc[VMIN] = 0;    // VMIN must be set to 0 so the VTIME works
+  attribs.c_cc[VTIME] = 20;   // Return, when a gapof 0.2 sec between the bytes is detected
+
+  tcflush(fd, TCIFLUSH);
+  if (tcsetattr(fd, TCSANOW, &attribs) < 0) {
+    printf("tcsetattr failed on %s\n", name);
+    close(fd);
+    return(-1);
+  }
+  printf("Opened serial device %s %i \n", name, fd);
+  return(fd);
+}
+
+/*
+ * Watch /dev and the directory of the device (e.g. /dev/serial/by-id) for new entries, so a
+ * replugged adapter is found at once. The by-id directory vanishes with the last USB serial adapter,
+ * so the watch is added again on every call.
+ */
+void watch_device(void)
+{
+#ifdef __linux__
+  char dir[PATH_MAX];
+
+  if (inotifyfd < 0) {
+    inotifyfd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (inotifyfd < 0) {
+      printf("inotify not available, polling for %s\n", serialname);
+      return;
+    }
+    inotify_add_watch(inotifyfd, "/dev", IN_CREATE | IN_ATTRIB);
+  }
+  strncpy(dir, serialname, PATH_MAX - 1);
+  dir[PATH_MAX - 1] = 0;
+  inotify_add_watch(inotifyfd, dirname(dir), IN_CREATE | IN_ATTRIB);
+#endif
+}
+
+/*
+ * Throw away queued inotify events, they are only of interest while the device is gone.
+ */
+void drain_watch(void)
+{
+#ifdef __linux__
+  char evbuf[BUFSIZE];
+
+  if (inotifyfd >= 0)
+    while (read(inotifyfd, evbuf, sizeof(evbuf)) > 0);
+#endif
+}
+
+/*
+ * Close a lost serial device and try to open it again. The device may have a new ttyUSB name after
+ * re-enumeration, which is covered if the stable /dev/serial/by-id path is given on the command line.
+ * Returns: fd of device, -1 if still not available
+ */
+int reopen_serial(void)
+{
+  if (dev >= 0) {
+    close(dev);
+    dev = -1;
+    drain_watch();     // Events collected while the device was open are stale
+  }
+  devlost = 0;
+  watch_device();
+  dev = open_serial(serialname);
+  if (dev >= 0) backoff = 1;
+  else if (!devevent) {      // Unrelated /dev events must not push the delay up
+    backoff *= 2;
+    if (backoff > MAXBACKOFF) backoff = MAXBACKOFF;
+  }
+  devevent = 0;
+  return(dev);
+}
+
+/*
+ * Seconds from a monotonic clock, not affected when NTP or GPS sets the time
+ */
+time_t monotime(void)
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return(ts.tv_sec);
+}
+
+/*
+ * Wait between two reads. Returns early if the serial device hangs up, or if a lost device
+ * reappears in /dev.
+ * Args: seconds to wait
+ */
+void wait_victron(int seconds)
+{
+  struct pollfd pfd[2];
+  int nfds = 0;
+  int devindex = -1;
+
+  if (dev >= 0) {
+    pfd[nfds].fd = dev;
+    pfd[nfds].events = 0;     // Only POLLHUP/POLLERR are of interest, data is read in read_victron
+    devindex = nfds++;
+  }
+  else if (inotifyfd >= 0) {
+    pfd[nfds].fd = inotifyfd;
+    pfd[nfds].events = POLLIN;
+    nfds++;
+  }
+  if (nfds == 0) {
+    sleep(seconds);
+    return;
+  }
+  if (poll(pfd, nfds, seconds * 1000) <= 0) return;
+  if ((devindex >= 0) && (pfd[devindex].revents & (POLLHUP|POLLERR|POLLNVAL))) {
+    printf("Serial device hangup\n");
+    devlost = 1;
+  }
+#ifdef __linux__
+  else if (inotifyfd >= 0) {
+    usleep(200000);      // Give udev time to set permissions and create the by-id link
+    drain_watch();       // Device is reopened anyway
+    devevent = 1;
+  }
+#endif
+}
+
+
 int main(int argc, char *argv[])
 {
   int sockfd, newsockfd, portno;
@@ -496,7 +683,6 @@ int main(int argc, char *argv[])
   struct hostent *server;
   char NMEADPTstring[200];
   int n, j;
-  int dev;
 
   if (argc < 3) {
        //nmeastring=P,$IIMTW,C
@@ -504,54 +690,13 @@ int main(int argc, char *argv[])
     exit(1);
   }
 
-    /* Open interface or die */
+    /* Open interface, a missing device is picked up later in the main loop */
 printf ("Starting %s\n",argv[1] );
    /* Open device (RW for now..let's ignore direction...) */
-  struct termios attribs;
-      dev = open(argv[1], (O_RDWR|O_NOCTTY));
- //     if ((dev = open(argv[1], (O_RDWR|O_NOCTTY|O_NONBLOCK))) < 0) {
-      if (dev < 0) {
-	 printf("Failed to open %s\n",*argv[1]);
-         return(-1);
-      }
-    speed_t speed;
-    /*
-    ** Get the current settings. This saves us from
-	 *           * having to initialize a struct termios from
-	 *                * scratch.
-	 *                     */
-    if(tcgetattr(dev, &attribs) < 0)
-    {
-       printf("Stdin Error");
-       return;
-    }
-	    /*
-	     *      * Set the speed data in the structure
-	     *           */
-    if(cfsetospeed(&attribs, B19200) < 0)
-    {
-     printf("invalid baud rate");
-     return;
-						    }
-	        /*
-		 *      * Apply the settings.
-		 *           */
-    attribs.c_lflag &= ~(ICANON|ECHO); /* Clear ICANON and ECHO. */
-    attribs.c_iflag &= ~(INLCR|ICRNL); /* Clear ICANON and ECHO. */
-    attribs.c_cc[VMIN] = 0;    // VMIN must be set to 0 so the VTIME works 
-    attribs.c_cc[VTIME] = 20;   // Return, when a gapof 0.2 sec between the bytes is detected
-
-    tcflush(dev, TCIFLUSH);
-    if(tcsetattr(dev, TCSANOW, &attribs) < 0)
-    {
-            printf("Stdin Error");
-            return;
-    }
-
+  serialname = argv[1];
+  dev = open_serial(serialname);      // If the adapter is not there yet, it is picked up in the main loop
+  watch_device();
 
-
-    printf("Opened serial device %s %i \n",argv[1],dev );
-  
     strncpy(nmeastring0.nmeastring, "$IIXDR\0", 7);  
     nmeastringv.nmeastring[0] = 0;
     nmeastringp.nmeastring[0] = 0;
@@ -649,7 +794,18 @@ printf ("Starting %s\n",argv[1] );
     printf("sockfd: %x, NMEAString: %s, n: %i", sockfd,NMEADPTstring, n); 
     n = sendto(sockfd,NMEADPTstring , n, 0, &serv_addr, sizeof(serv_addr));
     printf("Sent %d bytes\n",n);
-    sleep(10);
+    if ((dev < 0) || devlost) {       // Retry soon, or at once when the device shows up, but keep 10 sec between sends
+      time_t until = monotime() + 10;
+      while (((dev < 0) || devlost) && (monotime() < until)) {
+        int remain = until - monotime();
+        wait_victron((backoff < remain) ? backoff : remain);
+        reopen_serial();
+      }
+    }
+    else {
+      wait_victron(10);
+      if (devlost) reopen_serial();    // Hangup while waiting, try to get the device back
+    }
   } while (n>=0);
   if (n < 0) printf("ERROR writing to socket");
   close(sockfd);